@@ -2,10 +2,13 @@
 
 void display_menu() {
     printf("\nSistema de Busqueda\n");
-    printf("1. Seleccionar primer criterio\n");
-    printf("2. Seleccionar segundo criterio\n");
+    printf("1. Añadir criterio (AND)\n");
+    printf("2. Añadir criterio en un nuevo grupo (OR)\n");
     printf("3. Realizar búsqueda\n");
     printf("4. Salir\n");
+    printf("5. Limpiar criterios\n");
+    printf("6. Seleccionar campos\n");
+    printf("7. Ordenar y limitar resultados\n");
     printf("Seleccione una opción: ");
 }
 
@@ -19,57 +22,151 @@ void display_criteria_menu() {
     printf("Seleccione un criterio: ");
 }
 
-void display_record(Record *rec) {
+void display_record(Record *rec, unsigned int mask) {
     printf("\n----------------------------------------");
-    printf("\nBlock Time: %s", rec->block_time);
-    printf("\nSlot: %u", rec->slot);
-    printf("\nTx Index: %u", rec->tx_idx);
-    printf("\nWallet: %s", rec->signing_wallet);
-    printf("\nDirection: %s", rec->direction);
-    printf("\nBase Coin: %s", rec->base_coin);
-    printf("\nBase Amount: %llu", rec->base_coin_amount);
-    printf("\nQuote Amount: %llu", rec->quote_coin_amount);
-    printf("\nVirtual token balance: %llu", rec->virtual_token_balance_after);
-    printf("\nVirtual sol balance: %llu", rec->virtual_sol_balance_after);
-    printf("\nSignature: %s", rec->signature);
-    printf("\nProvided gas fee: %llu", rec->provided_gas_fee);
-    printf("\nProvided gas limit: %llu", rec->provided_gas_limit);
-    printf("\nFee: %llu", rec->fee);
-    printf("\nConsumed gas: %llu", rec->consumed_gas);
+    for (int f = 0; f < FIELD_COUNT; f++) {
+        if (!(mask & (1u << f))) continue;
+        const FieldInfo *info = record_field(f);
+        if (info->is_text) {
+            printf("\n%s: %s", info->name, (char *)rec + info->offset);
+        } else {
+            printf("\n%s: %llu", info->name, record_field_value(rec, f));
+        }
+    }
     printf("\n----------------------------------------\n");
 }
 
-int get_criteria_value(SearchType type, void *value, int dato) {
+void display_fields_menu() {
+    printf("\nCampos disponibles:\n");
+    for (int f = 0; f < FIELD_COUNT; f++) {
+        printf("%d. %s\n", f + 1, record_field(f)->name);
+    }
+    printf("Ingrese los campos separados por comas (0 = todos): ");
+}
+
+// ORDER BY sobre un campo numérico y LIMIT
+int read_order(SearchRequest *req) {
+    printf("\nCampos numericos:\n");
+    for (int f = 0; f < FIELD_COUNT; f++) {
+        if (!record_field(f)->is_text) printf("%d. %s\n", f + 1, record_field(f)->name);
+    }
+    printf("Ingrese el campo (0 = sin orden): ");
+    int field;
+    if (scanf("%d", &field) != 1) return 0;
+    if (field == 0) {
+        req->order_by = ORDER_NONE;
+    } else if (field < 1 || field > FIELD_COUNT || record_field(field - 1)->is_text) {
+        return 0;
+    } else {
+        char direction[8];
+        printf("Orden (asc/desc): ");
+        if (scanf("%7s", direction) != 1) return 0;
+        req->order_by = field - 1;
+        req->descending = strcmp(direction, "desc") == 0;
+    }
+
+    printf("Limite de resultados (0 = sin limite): ");
+    return scanf("%u", &req->limit) == 1;
+}
+
+// Lee una lista como "2,3,14" y devuelve la máscara (0 = todos los campos)
+int read_field_mask(unsigned int *mask) {
+    char text[128];
+    if (scanf("%127s", text) != 1) return 0;
+
+    unsigned int result = 0;
+    for (char *token = strtok(text, ","); token; token = strtok(NULL, ",")) {
+        int field = atoi(token);
+        if (field == 0) {
+            result = 0;
+            break;
+        }
+        if (field < 1 || field > FIELD_COUNT) return 0;
+        result |= 1u << (field - 1);
+    }
+    *mask = result;
+    return 1;
+}
+
+// Lee exactamente size bytes de la tubería (read puede devolver menos)
+int read_full(int fd, void *buffer, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = read(fd, (char *)buffer + done, size - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        done += n;
+    }
+    return 1;
+}
+
+// Acepta "valor" o "min-max"
+int parse_range(const char *text, Predicate *pred) {
+    if (sscanf(text, "%llu-%llu", &pred->min, &pred->max) == 2) {
+        return pred->min <= pred->max;
+    }
+    if (sscanf(text, "%llu", &pred->min) == 1) {
+        pred->max = pred->min;
+        return 1;
+    }
+    return 0;
+}
+
+int get_criteria_value(SearchType type, Predicate *pred, int dato) {
+    char text[32];
     switch (type) {
         case SEARCH_BY_SLOT:
-            printf("Ingrese slot: ");
-            return scanf("%u", (unsigned int*)value) == 1;
+            printf("Ingrese slot (valor o min-max): ");
+            return scanf("%31s", text) == 1 && parse_range(text, pred);
             
         case SEARCH_BY_TX_IDX:
-            printf("Ingrese tx_idx: ");
-            return scanf("%u", (unsigned int*)value) == 1;
+            printf("Ingrese tx_idx (valor o min-max): ");
+            return scanf("%31s", text) == 1 && parse_range(text, pred);
             
         case SEARCH_BY_DIRECTION:
             printf("Ingrese direccion (buy/sell): ");
-            return scanf("%4s", (char*)value) == 1;
+            return scanf("%4s", pred->text) == 1;
             
         case SEARCH_BY_WALLET:
             printf("Ingrese wallet: ");
-            return scanf("%49s", (char*)value) == 1;
+            return scanf("%49s", pred->text) == 1;
             
         case SEARCH_BY_ROW:
-            printf("Ingrese numero de fila (1 - %u): ", dato);
-            return scanf("%u", (unsigned int*)value) == 1;
+            printf("Ingrese numero de fila o rango (1 - %u): ", dato);
+            return scanf("%31s", text) == 1 && parse_range(text, pred);
                         
         default:
             return 0;
     }
 }
 
+void add_criterion(SearchRequest *req, int group, unsigned int record_count) {
+    if (req->predicate_count >= MAX_PREDICATES) {
+        printf("Error: Maximo de %d criterios\n", MAX_PREDICATES);
+        return;
+    }
+
+    Predicate *pred = &req->predicates[req->predicate_count];
+    memset(pred, 0, sizeof(Predicate));
+    display_criteria_menu();
+    scanf("%d", (int*)&pred->type);
+    getchar();
+
+    if (!get_criteria_value(pred->type, pred, record_count)) {
+        printf("Error: Valor invalido\n");
+        return;
+    }
+    pred->group = group;
+    req->predicate_count++;
+}
+
 int main() {
-    // Cargar metadatos
+    // Cargar metadatos de la versión activa (o del directorio actual)
     Metadata meta;
-    int meta_fd = open(METADATA_FILE, O_RDONLY);
+    char meta_path[256];
+    snprintf(meta_path, sizeof(meta_path), "%s/%s", CURRENT_LINK, METADATA_FILE);
+    int meta_fd = open(meta_path, O_RDONLY);
+    if (meta_fd < 0) meta_fd = open(METADATA_FILE, O_RDONLY);
     if (meta_fd < 0) {
         perror("Error abriendo metadatos");
         return 1;
@@ -94,8 +191,8 @@ int main() {
     SearchRequest req;
     memset(&req, 0, sizeof(SearchRequest));
     req.client_pid = client_pid;
-    req.type1 = 0;
-    req.type2 = 0;
+    req.order_by = ORDER_NONE;
+    int group = 0;
 
     do {
         display_menu();
@@ -103,30 +200,17 @@ int main() {
         getchar();  // Limpiar buffer
 
         switch(option) {
-            case 1:  // Seleccionar primer criterio
-                display_criteria_menu();
-                scanf("%d", (int*)&req.type1);
-                getchar();
-                
-                if (!get_criteria_value(req.type1, &req.param1, meta.record_count)) {
-                    printf("Error: Valor invalido\n");
-                    req.type1 = 0;
-                }
+            case 1:  // Criterio en el grupo actual
+                add_criterion(&req, group, meta.record_count);
                 break;
                 
-            case 2:  // Seleccionar segundo criterio
-                display_criteria_menu();
-                scanf("%d", (int*)&req.type2);
-                getchar();
-                
-                if (!get_criteria_value(req.type2, &req.param2, meta.record_count)) {
-                    printf("Error: Valor invalido\n");
-                    req.type2 = 0;
-                }
+            case 2:  // Criterio en un grupo nuevo
+                if (req.predicate_count > 0 && group + 1 < MAX_PREDICATES) group++;
+                add_criterion(&req, group, meta.record_count);
                 break;
                 
             case 3:  // Realizar búsqueda
-                if (req.type1 == 0 && req.type2 == 0) {
+                if (req.predicate_count == 0) {
                     printf("Error: Seleccione al menos un criterio\n");
                     break;
                 }
@@ -147,19 +231,35 @@ int main() {
                     break;
                 }
 
-                int count;
-                read(response_fd, &count, sizeof(int));
+                int count = 0;
+                if (!read_full(response_fd, &count, sizeof(int))) {
+                    printf("Error: Respuesta incompleta\n");
+                    close(response_fd);
+                    break;
+                }
 
                 if (count == 0) {
                     printf("\nNA - No se encontraron resultados\n");
                 } else {
-                    Record *results = malloc(count * sizeof(Record));
-                    read(response_fd, results, count * sizeof(Record));
+                    // Las filas llegan compactas y se decodifican al mostrarlas
+                    uint64_t size = 0;
+                    unsigned char *results = NULL;
+                    if (!read_full(response_fd, &size, sizeof(uint64_t)) ||
+                        !(results = malloc(size)) || !read_full(response_fd, results, size)) {
+                        printf("Error: Respuesta incompleta\n");
+                        free(results);
+                        close(response_fd);
+                        break;
+                    }
 
-                    printf("\nResultados encontrados: %d\n", count);
+                    unsigned int mask = effective_field_mask(req.field_mask);
+                    printf("\nResultados encontrados: %d (%llu bytes)\n", count, (unsigned long long)size);
+                    size_t pos = 0;
                     for (int i = 0; i < count && i < 10; i++) {
+                        Record record;
+                        pos += unpack_record(results + pos, mask, &record);
                         printf("\nResultado %d:", i + 1);
-                        display_record(&results[i]);
+                        display_record(&record, mask);
                     }
                     
                     if (count > 10) {
@@ -174,6 +274,27 @@ int main() {
                 printf("Saliendo...\n");
                 break;
                 
+            case 5:
+                req.predicate_count = 0;
+                group = 0;
+                printf("Criterios eliminados\n");
+                break;
+                
+            case 6:
+                display_fields_menu();
+                if (!read_field_mask(&req.field_mask)) {
+                    printf("Error: Valor invalido\n");
+                }
+                break;
+                
+            case 7:
+                if (!read_order(&req)) {
+                    printf("Error: Valor invalido\n");
+                    req.order_by = ORDER_NONE;
+                    req.limit = 0;
+                }
+                break;
+                
             default:
                 printf("Opción invalida\n");
         }
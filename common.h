@@ -13,10 +13,18 @@
 #include <errno.h>
 #include <signal.h>
 #include <sys/mman.h>
+#include <stddef.h>
 
 #define DATA_FILE "data.bin"
 #define SLOT_INDEX_FILE "slot_index.bin"
 #define METADATA_FILE "metadata.bin"
+#define HASH_FILE "hashtable.bin"
+#define STATS_FILE "stats.bin"
+#define WALLET_DICT_FILE "wallets.bin"         // Wallets distintas ordenadas; id = posición
+#define WALLET_INDEX_FILE "wallet_index.bin"   // Índice compuesto (wallet, slot, tx_idx)
+#define SEGMENTS_DIR "segments"          // Una subcarpeta por cada versión generada
+#define CURRENT_LINK "current"           // Enlace simbólico a la versión activa
+#define RELOAD_POLL_SECONDS 1            // Intervalo de comprobación de nuevas versiones
 #define MAX_MEMORY 10 * 1024 * 1024
 #define REQUEST_PIPE "/tmp/search_request"
 #define RESPONSE_PIPE_TEMPLATE "/tmp/search_response_%d"
@@ -50,6 +58,133 @@ typedef struct {
     unsigned long consumed_gas;
 } Record;
 
+// Campos de Record, en el orden en que se serializan
+typedef enum {
+    FIELD_BLOCK_TIME,
+    FIELD_SLOT,
+    FIELD_TX_IDX,
+    FIELD_WALLET,
+    FIELD_DIRECTION,
+    FIELD_BASE_COIN,
+    FIELD_BASE_AMOUNT,
+    FIELD_QUOTE_AMOUNT,
+    FIELD_VIRTUAL_TOKEN_BALANCE,
+    FIELD_VIRTUAL_SOL_BALANCE,
+    FIELD_SIGNATURE,
+    FIELD_GAS_FEE,
+    FIELD_GAS_LIMIT,
+    FIELD_FEE,
+    FIELD_CONSUMED_GAS,
+    FIELD_COUNT
+} RecordField;
+
+#define FIELD_MASK_ALL ((1u << FIELD_COUNT) - 1)
+
+typedef struct {
+    const char *name;
+    size_t offset;
+    size_t size;
+    int is_text;
+} FieldInfo;
+
+static inline const FieldInfo *record_field(RecordField field) {
+    static const FieldInfo fields[FIELD_COUNT] = {
+        { "Block Time", offsetof(Record, block_time), sizeof(((Record *)0)->block_time), 1 },
+        { "Slot", offsetof(Record, slot), sizeof(unsigned int), 0 },
+        { "Tx Index", offsetof(Record, tx_idx), sizeof(unsigned int), 0 },
+        { "Wallet", offsetof(Record, signing_wallet), sizeof(((Record *)0)->signing_wallet), 1 },
+        { "Direction", offsetof(Record, direction), sizeof(((Record *)0)->direction), 1 },
+        { "Base Coin", offsetof(Record, base_coin), sizeof(((Record *)0)->base_coin), 1 },
+        { "Base Amount", offsetof(Record, base_coin_amount), sizeof(unsigned long long), 0 },
+        { "Quote Amount", offsetof(Record, quote_coin_amount), sizeof(unsigned long long), 0 },
+        { "Virtual token balance", offsetof(Record, virtual_token_balance_after), sizeof(unsigned long long), 0 },
+        { "Virtual sol balance", offsetof(Record, virtual_sol_balance_after), sizeof(unsigned long long), 0 },
+        { "Signature", offsetof(Record, signature), sizeof(((Record *)0)->signature), 1 },
+        { "Provided gas fee", offsetof(Record, provided_gas_fee), sizeof(unsigned long), 0 },
+        { "Provided gas limit", offsetof(Record, provided_gas_limit), sizeof(unsigned long), 0 },
+        { "Fee", offsetof(Record, fee), sizeof(unsigned long), 0 },
+        { "Consumed gas", offsetof(Record, consumed_gas), sizeof(unsigned long), 0 }
+    };
+    return &fields[field];
+}
+
+// Valor numérico de un campo (0 para campos de texto)
+static inline unsigned long long record_field_value(const Record *rec, RecordField field) {
+    const FieldInfo *info = record_field(field);
+    const char *src = (const char *)rec + info->offset;
+    if (info->is_text) return 0;
+    if (info->size == sizeof(unsigned int)) return *(const unsigned int *)src;
+    if (info->size == sizeof(unsigned long long)) return *(const unsigned long long *)src;
+    return *(const unsigned long *)src;
+}
+
+// Fila compacta: solo los campos de mask, en orden. Los numéricos van con su
+// tamaño nativo; los textos como longitud (1 byte) seguida de los caracteres.
+static inline size_t pack_record(const Record *rec, unsigned int mask, unsigned char *out) {
+    size_t pos = 0;
+    for (int f = 0; f < FIELD_COUNT; f++) {
+        if (!(mask & (1u << f))) continue;
+        const FieldInfo *info = record_field(f);
+        const char *src = (const char *)rec + info->offset;
+        if (info->is_text) {
+            size_t len = strnlen(src, info->size - 1);
+            out[pos++] = (unsigned char)len;
+            memcpy(out + pos, src, len);
+            pos += len;
+        } else {
+            memcpy(out + pos, src, info->size);
+            pos += info->size;
+        }
+    }
+    return pos;
+}
+
+// Campos que realmente se envían: los bits válidos de mask, o todos si no queda ninguno
+static inline unsigned int effective_field_mask(unsigned int mask) {
+    mask &= FIELD_MASK_ALL;
+    return mask ? mask : FIELD_MASK_ALL;
+}
+
+// Tamaño máximo de una fila compacta con los campos de mask
+static inline size_t packed_row_limit(unsigned int mask) {
+    size_t size = 0;
+    for (int f = 0; f < FIELD_COUNT; f++) {
+        if (mask & (1u << f)) size += record_field(f)->size;
+    }
+    return size;
+}
+
+// Inverso de pack_record; los campos ausentes quedan a cero
+static inline size_t unpack_record(const unsigned char *in, unsigned int mask, Record *rec) {
+    size_t pos = 0;
+    memset(rec, 0, sizeof(Record));
+    for (int f = 0; f < FIELD_COUNT; f++) {
+        if (!(mask & (1u << f))) continue;
+        const FieldInfo *info = record_field(f);
+        char *dst = (char *)rec + info->offset;
+        if (info->is_text) {
+            size_t len = in[pos++];
+            if (len > info->size - 1) len = info->size - 1;
+            memcpy(dst, in + pos, len);
+            pos += len;
+        } else {
+            memcpy(dst, in + pos, info->size);
+            pos += info->size;
+        }
+    }
+    return pos;
+}
+
+#define WALLET_SIZE sizeof(((Record *)0)->signing_wallet)
+
+// Entrada del índice compuesto, ordenado por (wallet_id, slot, tx_idx)
+typedef struct {
+    uint32_t wallet_id;
+    uint32_t slot;
+    uint32_t tx_idx;
+    long offset;            // Offset en data.bin
+} WalletIndexEntry;
+
 // Índice de bloques
 typedef struct {
     unsigned int min_slot;
@@ -64,27 +199,48 @@ typedef struct {
     size_t record_size;
 } Metadata;
 
-// Solicitud de búsqueda combinada
+// Estadísticas para el planificador (stats.bin)
+typedef struct {
+    unsigned int min_slot;
+    unsigned int max_slot;
+    unsigned int distinct_slots;
+    unsigned int max_tx_idx;
+} Statistics;
+
+#define MAX_PREDICATES 16
+
+// Predicado de búsqueda. Slot, tx_idx y fila admiten rangos [min, max];
+// en una igualdad min == max. Dirección y wallet se comparan con text.
+typedef struct {
+    SearchType type;
+    unsigned char group;     // Mismo grupo: AND. Grupos distintos: OR
+    unsigned long long min;
+    unsigned long long max;
+    char text[50];
+} Predicate;
+
+// Solicitud de búsqueda: (p AND p ...) OR (p AND p ...) ...
+// La respuesta es: int count y, si count > 0, uint64_t con el tamaño de las filas
+// compactas seguido de las filas (ver pack_record).
+// Se mantiene por debajo de PIPE_BUF para que la escritura en la FIFO sea atómica.
+#define ORDER_NONE -1
+
 typedef struct {
     int client_pid;
-    SearchType type1;
-    SearchType type2;
-    union {
-        unsigned int slot;
-        unsigned int tx_idx;
-        unsigned int row;
-        char direction[5];
-        char wallet[50];
-    } param1;
-    union {
-        unsigned int slot;
-        unsigned int tx_idx;
-        unsigned int row;
-        char direction[5];
-        char wallet[50];
-    } param2;
+    unsigned int field_mask;  // Campos a devolver (bits de RecordField); 0 = todos
+    int order_by;             // Campo numérico (RecordField) u ORDER_NONE
+    int descending;
+    unsigned int limit;       // Máximo de filas devueltas; 0 = sin límite
+    int predicate_count;
+    Predicate predicates[MAX_PREDICATES];
 } SearchRequest;
 
+// Entrada del índice ordenado (hashtable.bin)
+typedef struct {
+    uint64_t key;           // slot << 32 | tx_idx
+    long offset;            // Offset en data.bin
+} FlatHashEntry;
+
 // Añadir al final de common.h
 typedef struct HashEntry {
     uint64_t key;           // slot << 32 | tx_idx
@@ -0,0 +1,130 @@
+#include "common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define DEFAULT_WALLETS 100000
+#define DEFAULT_BUY_RATIO 0.55
+#define BASE_COINS 5000
+#define FIRST_SLOT 250000000u
+#define FIRST_BLOCK_TIME 1704067200LL  // 2024-01-01 00:00:00 UTC
+#define SLOT_MS 400
+#define OUTPUT_BUFFER (8 * 1024 * 1024)
+
+static const char BASE58[] = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+
+static uint64_t rng_state = 88172645463325252ULL;
+
+// xorshift64*: rápido y reproducible a partir de la semilla
+uint64_t next_random(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ULL;
+}
+
+double next_uniform(void) {
+    return (next_random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Rango con sesgo tipo Zipf: unas pocas wallets concentran la mayoría de operaciones
+unsigned long skewed_rank(unsigned long n) {
+    unsigned long rank = (unsigned long)(exp(next_uniform() * log((double)n + 1)) - 1);
+    return rank < n ? rank : n - 1;
+}
+
+// Valor log-uniforme en [lo, hi]
+unsigned long long log_uniform(unsigned long long lo, unsigned long long hi) {
+    return (unsigned long long)exp(log((double)lo) + next_uniform() * (log((double)hi) - log((double)lo)));
+}
+
+// Dirección base58 determinista para un identificador
+void make_address(uint64_t id, uint64_t salt, char *out, int len) {
+    uint64_t x = id * 0x9E3779B97F4A7C15ULL ^ salt;
+    for (int i = 0; i < len; i++) {
+        x ^= x >> 33;
+        x *= 0xFF51AFD7ED558CCDULL;
+        x ^= x >> 29;
+        out[i] = BASE58[x % 58];
+    }
+    out[len] = '\0';
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        printf("Usage: %s <rows> <output_csv> [seed] [wallets] [buy_ratio]\n", argv[0]);
+        return 1;
+    }
+
+    unsigned long long rows = strtoull(argv[1], NULL, 10);
+    unsigned long long seed = argc > 3 ? strtoull(argv[3], NULL, 10) : 1;
+    unsigned long wallets = argc > 4 ? strtoul(argv[4], NULL, 10) : DEFAULT_WALLETS;
+    double buy_ratio = argc > 5 ? atof(argv[5]) : DEFAULT_BUY_RATIO;
+    if (wallets == 0 || buy_ratio < 0 || buy_ratio > 1) {
+        fprintf(stderr, "Invalid wallets or buy_ratio\n");
+        return 1;
+    }
+    rng_state ^= seed * 0x9E3779B97F4A7C15ULL;
+    if (rng_state == 0) rng_state = 1;
+
+    FILE *csv = fopen(argv[2], "w");
+    if (!csv) {
+        perror("Error opening output CSV");
+        return 1;
+    }
+    setvbuf(csv, NULL, _IOFBF, OUTPUT_BUFFER);
+
+    fprintf(csv, "block_time,slot,tx_idx,signing_wallet,direction,base_coin,base_coin_amount,"
+                 "quote_coin_amount,virtual_token_balance_after,virtual_sol_balance_after,signature,"
+                 "provided_gas_fee,provided_gas_limit,fee,consumed_gas\n");
+
+    unsigned int slot = FIRST_SLOT;
+    unsigned int tx_idx = 0;
+    long long cached_second = -1;
+    char block_time[20] = "";
+    char wallet[45], base_coin[45], signature[89];
+
+    for (unsigned long long i = 0; i < rows; i++) {
+        // Slots monótonos: varias transacciones por slot y algún slot vacío
+        if (i > 0 && next_uniform() < 0.25) {
+            slot += 1 + (next_random() % 8 == 0);
+            tx_idx = 0;
+        }
+
+        long long second = FIRST_BLOCK_TIME + (long long)(slot - FIRST_SLOT) * SLOT_MS / 1000;
+        if (second != cached_second) {
+            time_t t = (time_t)second;
+            struct tm tm;
+            gmtime_r(&t, &tm);
+            strftime(block_time, sizeof(block_time), "%Y-%m-%d %H:%M:%S", &tm);
+            cached_second = second;
+        }
+
+        make_address(skewed_rank(wallets), 0x57A11E7ULL, wallet, 44);
+        make_address(skewed_rank(BASE_COINS), 0xC014ULL, base_coin, 44);
+        make_address(i, seed, signature, 88);
+
+        int buy = next_uniform() < buy_ratio;
+        unsigned long long base_amount = log_uniform(1000, 100000000000000ULL);
+        unsigned long long quote_amount = log_uniform(10000, 1000000000000ULL);
+        unsigned long gas_limit = 200000 + (next_random() % 1200000);
+        unsigned long gas_fee = 5000 + (next_random() % 3) * 5000;
+        unsigned long consumed = gas_limit / 4 + next_random() % (gas_limit / 2);
+
+        fprintf(csv, "%s,%u,%u,%s,%s,%s,%llu,%llu,%llu,%llu,%s,%lu,%lu,%lu,%lu\n",
+                block_time, slot, tx_idx, wallet, buy ? "buy" : "sell", base_coin,
+                base_amount, quote_amount,
+                log_uniform(1000000, 1073000000000000ULL), log_uniform(30000000000ULL, 115000000000ULL),
+                signature, gas_fee, gas_limit, gas_fee + (unsigned long)log_uniform(1, 10000000), consumed);
+        tx_idx++;
+    }
+
+    if (fclose(csv) != 0) {
+        perror("Error writing output CSV");
+        return 1;
+    }
+
+    printf("Dataset generado: %llu filas en %s\n", rows, argv[2]);
+    return 0;
+}
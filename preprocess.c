@@ -3,15 +3,11 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/resource.h>
 
 #define HASH_SIZE 1000003
 #define BLOCK_SIZE 5000
 
-typedef struct {
-    uint64_t key;
-    long offset;
-} FlatHashEntry;
-
 unsigned int hash_function(uint64_t key) {
     return key % HASH_SIZE;
 }
@@ -29,27 +25,223 @@ void hash_table_insert(HashTable* table, uint64_t key, long offset) {
     table->buckets[bucket] = entry;
 }
 
+// Diccionario de wallets durante la carga: id provisional por orden de aparición
+typedef struct {
+    int *buckets;
+    int *next;
+    char (*names)[WALLET_SIZE];
+    unsigned int count;
+    unsigned int capacity;
+} WalletTable;
+
+typedef struct {
+    char name[WALLET_SIZE];
+    unsigned int id;
+} WalletName;
+
+unsigned int wallet_hash(const char *name) {
+    uint32_t h = 2166136261u;
+    for (; *name; name++) {
+        h = (h ^ (unsigned char)*name) * 16777619u;
+    }
+    return h % HASH_SIZE;
+}
+
+unsigned int wallet_table_id(WalletTable *table, const char *name) {
+    unsigned int bucket = wallet_hash(name);
+    for (int i = table->buckets[bucket]; i >= 0; i = table->next[i]) {
+        if (strcmp(table->names[i], name) == 0) return i;
+    }
+
+    if (table->count == table->capacity) {
+        table->capacity = table->capacity ? table->capacity * 2 : 1024;
+        table->next = realloc(table->next, table->capacity * sizeof(int));
+        table->names = realloc(table->names, table->capacity * WALLET_SIZE);
+        if (!table->next || !table->names) {
+            perror("Error al asignar memoria para el diccionario de wallets");
+            exit(1);
+        }
+    }
+    unsigned int id = table->count++;
+    strncpy(table->names[id], name, WALLET_SIZE - 1);
+    table->names[id][WALLET_SIZE - 1] = '\0';
+    table->next[id] = table->buckets[bucket];
+    table->buckets[bucket] = id;
+    return id;
+}
+
+int compare_wallet_names(const void* a, const void* b) {
+    return strcmp(((WalletName*)a)->name, ((WalletName*)b)->name);
+}
+
+int compare_wallet_entries(const void* a, const void* b) {
+    const WalletIndexEntry *ea = a, *eb = b;
+    if (ea->wallet_id != eb->wallet_id) return (ea->wallet_id > eb->wallet_id) - (ea->wallet_id < eb->wallet_id);
+    if (ea->slot != eb->slot) return (ea->slot > eb->slot) - (ea->slot < eb->slot);
+    return (ea->tx_idx > eb->tx_idx) - (ea->tx_idx < eb->tx_idx);
+}
+
+// Escribe wallets.bin (ordenado) y wallet_index.bin con los ids definitivos
+int write_wallet_index(const char *dir, WalletTable *table, WalletIndexEntry *entries, size_t count) {
+    WalletName *sorted = malloc((table->count + 1) * sizeof(WalletName));
+    unsigned int *final_id = malloc((table->count + 1) * sizeof(unsigned int));
+    if (!sorted || !final_id) {
+        perror("Error allocating wallet dictionary");
+        free(sorted);
+        free(final_id);
+        return -1;
+    }
+    for (unsigned int i = 0; i < table->count; i++) {
+        memcpy(sorted[i].name, table->names[i], WALLET_SIZE);
+        sorted[i].id = i;
+    }
+    qsort(sorted, table->count, sizeof(WalletName), compare_wallet_names);
+    for (unsigned int i = 0; i < table->count; i++) {
+        final_id[sorted[i].id] = i;
+    }
+    for (size_t i = 0; i < count; i++) {
+        entries[i].wallet_id = final_id[entries[i].wallet_id];
+    }
+    qsort(entries, count, sizeof(WalletIndexEntry), compare_wallet_entries);
+
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", dir, WALLET_DICT_FILE);
+    FILE *dict_file = fopen(path, "wb");
+    snprintf(path, sizeof(path), "%s/%s", dir, WALLET_INDEX_FILE);
+    FILE *index_file = fopen(path, "wb");
+    int ok = dict_file && index_file;
+    if (!ok) {
+        perror("Error abriendo archivos del índice de wallets");
+    } else {
+        for (unsigned int i = 0; i < table->count; i++) {
+            fwrite(sorted[i].name, WALLET_SIZE, 1, dict_file);
+        }
+        fwrite(entries, sizeof(WalletIndexEntry), count, index_file);
+    }
+    if (dict_file) fclose(dict_file);
+    if (index_file) fclose(index_file);
+
+    free(sorted);
+    free(final_id);
+    return ok ? 0 : -1;
+}
+
 int compare_keys(const void* a, const void* b) {
     uint64_t ka = ((FlatHashEntry*)a)->key;
     uint64_t kb = ((FlatHashEntry*)b)->key;
     return (ka > kb) - (ka < kb);
 }
 
+// Crea segments/v<tiempo>_<pid>/ donde se escribe la nueva versión del índice
+int create_version_dir(char *dir, size_t size) {
+    if (mkdir(SEGMENTS_DIR, 0755) < 0 && errno != EEXIST) {
+        perror("Error creating segments directory");
+        return -1;
+    }
+    snprintf(dir, size, "%s/v%lld_%d", SEGMENTS_DIR, (long long)time(NULL), (int)getpid());
+    if (mkdir(dir, 0755) < 0) {
+        perror("Error creating version directory");
+        return -1;
+    }
+    return 0;
+}
+
+// Apunta CURRENT_LINK a la nueva versión de forma atómica (symlink + rename)
+int publish_version(const char *dir) {
+    char tmp_link[256];
+    snprintf(tmp_link, sizeof(tmp_link), "%s.tmp.%d", CURRENT_LINK, (int)getpid());
+    unlink(tmp_link);
+    if (symlink(dir, tmp_link) < 0) {
+        perror("Error creating temporary link");
+        return -1;
+    }
+    if (rename(tmp_link, CURRENT_LINK) < 0) {
+        perror("Error publishing new version");
+        unlink(tmp_link);
+        return -1;
+    }
+    return 0;
+}
+
+double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+long long file_size(const char *dir, const char *name) {
+    char path[256];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    return stat(path, &st) == 0 ? (long long)st.st_size : -1;
+}
+
+// Informe de rendimiento de la ingesta (opción -t)
+void print_ingest_report(const char *input, const char *dir, unsigned int records,
+                         double parse_time, double write_time, double index_time, double total_time) {
+    struct stat st;
+    double input_mb = stat(input, &st) == 0 ? st.st_size / (1024.0 * 1024.0) : 0;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf("\nIngest benchmark\n");
+    printf("  Rows:        %u\n", records);
+    printf("  Input:       %.1f MB\n", input_mb);
+    printf("  Total time:  %.3f s\n", total_time);
+    printf("  Throughput:  %.0f rows/s, %.1f MB/s\n",
+           total_time > 0 ? records / total_time : 0, total_time > 0 ? input_mb / total_time : 0);
+    printf("  Peak RSS:    %ld KB\n", usage.ru_maxrss);
+    printf("  %-12s %10s  %s\n", "Phase", "Time (s)", "Output (bytes)");
+    printf("  %-12s %10.3f\n", "parse", parse_time);
+    printf("  %-12s %10.3f  %s: %lld\n", "write data", write_time, DATA_FILE, file_size(dir, DATA_FILE));
+    printf("  %-12s %10.3f  %s: %lld, %s: %lld, %s: %lld, %s: %lld\n", "build index", index_time,
+           HASH_FILE, file_size(dir, HASH_FILE), SLOT_INDEX_FILE, file_size(dir, SLOT_INDEX_FILE),
+           STATS_FILE, file_size(dir, STATS_FILE), METADATA_FILE, file_size(dir, METADATA_FILE));
+    if (file_size(dir, WALLET_INDEX_FILE) >= 0) {
+        printf("  %-12s %10s  %s: %lld, %s: %lld\n", "", "",
+               WALLET_DICT_FILE, file_size(dir, WALLET_DICT_FILE), WALLET_INDEX_FILE, file_size(dir, WALLET_INDEX_FILE));
+    }
+}
+
 int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        printf("Usage: %s <input_csv>\n", argv[0]);
+    int timing = 0;         // -t: informe de rendimiento
+    int wallet_index = 0;   // -w: índice compuesto (wallet, slot, tx_idx)
+    int opt;
+    while ((opt = getopt(argc, argv, "tw")) != -1) {
+        if (opt == 't') timing = 1;
+        else if (opt == 'w') wallet_index = 1;
+        else optind = argc + 1;
+    }
+    if (optind >= argc) {
+        printf("Usage: %s [-t] [-w] <input_csv>\n", argv[0]);
         return 1;
     }
+    const char *input = argv[optind];
+    double start_time = now_seconds();
+    double parse_time = 0, write_time = 0, index_time = 0;
 
-    FILE *csv = fopen(argv[1], "r");
+    FILE *csv = fopen(input, "r");
     if (!csv) {
         perror("Error opening CSV file");
         return 1;
     }
 
-    FILE *data_file = fopen(DATA_FILE, "wb");
-    FILE *slot_file = fopen(SLOT_INDEX_FILE, "wb");
-    FILE *meta_file = fopen(METADATA_FILE, "wb");
+    char version_dir[128];
+    if (create_version_dir(version_dir, sizeof(version_dir)) < 0) {
+        fclose(csv);
+        return 1;
+    }
+
+    char data_path[256], slot_path[256], meta_path[256], hash_path[256], stats_path[256];
+    snprintf(data_path, sizeof(data_path), "%s/%s", version_dir, DATA_FILE);
+    snprintf(slot_path, sizeof(slot_path), "%s/%s", version_dir, SLOT_INDEX_FILE);
+    snprintf(meta_path, sizeof(meta_path), "%s/%s", version_dir, METADATA_FILE);
+    snprintf(hash_path, sizeof(hash_path), "%s/%s", version_dir, HASH_FILE);
+    snprintf(stats_path, sizeof(stats_path), "%s/%s", version_dir, STATS_FILE);
+
+    FILE *data_file = fopen(data_path, "wb");
+    FILE *slot_file = fopen(slot_path, "wb");
+    FILE *meta_file = fopen(meta_path, "wb");
     
     if (!data_file || !slot_file || !meta_file) {
         perror("Error opening output files");
@@ -77,12 +269,30 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    WalletTable wallets = { NULL, NULL, NULL, 0, 0 };
+    WalletIndexEntry *wallet_entries = NULL;
+    size_t wallet_capacity = 0;
+    if (wallet_index) {
+        wallets.buckets = malloc(HASH_SIZE * sizeof(int));
+        if (!wallets.buckets) {
+            perror("Error al asignar memoria para el diccionario de wallets");
+            return 1;
+        }
+        memset(wallets.buckets, -1, HASH_SIZE * sizeof(int));
+    }
+
     Record record;
     Metadata meta = {
         .record_count = 0,
         .block_count = 0,
         .record_size = sizeof(Record)
     };
+    Statistics stats = {
+        .min_slot = UINT32_MAX,
+        .max_slot = 0,
+        .distinct_slots = 0,
+        .max_tx_idx = 0
+    };
     
     long current_offset = 0;
     unsigned int current_block_min = 0;
@@ -90,6 +300,7 @@ int main(int argc, char *argv[]) {
     long current_block_offset = 0;
     int records_in_current_block = 0;
 
+    double mark = timing ? now_seconds() : 0;
     while (fgets(line, sizeof(line), csv)) {
         if (sscanf(line, "%19[^,],%u,%u,%49[^,],%4[^,],%99[^,],%llu,%llu,%llu,%llu,%99[^,],%lu,%lu,%lu,%lu",
                record.block_time, &record.slot, &record.tx_idx, record.signing_wallet, 
@@ -101,13 +312,43 @@ int main(int argc, char *argv[]) {
             fprintf(stderr, "Error parsing line: %s\n", line);
             continue;
         }
+        if (timing) {
+            double t = now_seconds();
+            parse_time += t - mark;
+            mark = t;
+        }
 
         // Escribir registro
         fwrite(&record, sizeof(Record), 1, data_file);
+        if (timing) {
+            double t = now_seconds();
+            write_time += t - mark;
+            mark = t;
+        }
+
+        if (record.slot < stats.min_slot) stats.min_slot = record.slot;
+        if (record.slot > stats.max_slot) stats.max_slot = record.slot;
+        if (record.tx_idx > stats.max_tx_idx) stats.max_tx_idx = record.tx_idx;
         
         // Insertar en tabla hash
         uint64_t key = ((uint64_t)record.slot << 32) | record.tx_idx;
         hash_table_insert(&hash_table, key, current_offset);
+
+        if (wallet_index) {
+            if (meta.record_count == wallet_capacity) {
+                wallet_capacity = wallet_capacity ? wallet_capacity * 2 : 4096;
+                wallet_entries = realloc(wallet_entries, wallet_capacity * sizeof(WalletIndexEntry));
+                if (!wallet_entries) {
+                    perror("Error al asignar memoria para el índice de wallets");
+                    exit(1);
+                }
+            }
+            WalletIndexEntry *we = &wallet_entries[meta.record_count];
+            we->wallet_id = wallet_table_id(&wallets, record.signing_wallet);
+            we->slot = record.slot;
+            we->tx_idx = record.tx_idx;
+            we->offset = current_offset;
+        }
         
         // Índice de bloques
         if (records_in_current_block == 0) {
@@ -134,7 +375,13 @@ int main(int argc, char *argv[]) {
 
         current_offset += sizeof(Record);
         meta.record_count++;
+        if (timing) {
+            double t = now_seconds();
+            index_time += t - mark;
+            mark = t;
+        }
     }
+    double index_start = timing ? now_seconds() : 0;
 
     // Último bloque
     if (records_in_current_block > 0) {
@@ -180,17 +427,45 @@ int main(int argc, char *argv[]) {
     // Ordenar por key
     qsort(flat_entries, total_entries, sizeof(FlatHashEntry), compare_keys);
 
+    // Slots distintos (las claves ordenadas agrupan cada slot)
+    for (int i = 0; i < total_entries; i++) {
+        if (i == 0 || (flat_entries[i].key >> 32) != (flat_entries[i - 1].key >> 32)) {
+            stats.distinct_slots++;
+        }
+    }
+    if (meta.record_count == 0) stats.min_slot = 0;
+
+    FILE* stats_file = fopen(stats_path, "wb");
+    if (!stats_file) {
+        perror("Error abriendo archivo de estadísticas");
+    } else {
+        fwrite(&stats, sizeof(Statistics), 1, stats_file);
+        fclose(stats_file);
+    }
+
     // Escribir archivo de hash
-    FILE* hash_file = fopen("hashtable.bin", "wb");
+    int hash_written = 0;
+    FILE* hash_file = fopen(hash_path, "wb");
     if (!hash_file) {
         perror("Error abriendo archivo de tabla hash");
     } else {
         fwrite(flat_entries, sizeof(FlatHashEntry), total_entries, hash_file);
         fclose(hash_file);
+        hash_written = 1;
     }
 
     free(flat_entries);
 
+    int wallets_written = 1;
+    if (wallet_index) {
+        wallets_written = write_wallet_index(version_dir, &wallets, wallet_entries, meta.record_count) == 0;
+        printf("Indice de wallets: %u wallets, %u entradas\n", wallets.count, meta.record_count);
+        free(wallet_entries);
+        free(wallets.buckets);
+        free(wallets.next);
+        free(wallets.names);
+    }
+
     // Liberar memoria de la tabla hash
     for (int i = 0; i < HASH_SIZE; i++) {
         HashEntry* entry = hash_table.buckets[i];
@@ -203,12 +478,27 @@ int main(int argc, char *argv[]) {
     free(hash_table.buckets);
 
     fclose(csv);
-    fclose(data_file);
     fclose(slot_file);
     fclose(meta_file);
+    if (timing) index_time += now_seconds() - index_start;
+
+    double flush_start = timing ? now_seconds() : 0;
+    fclose(data_file);
+    if (timing) write_time += now_seconds() - flush_start;
+
+    // Solo se publica la versión cuando todos los archivos están completos
+    if (!hash_written || !wallets_written || publish_version(version_dir) < 0) {
+        fprintf(stderr, "Version %s was not published\n", version_dir);
+        return 1;
+    }
 
     printf("Preprocesamiento completado. Registros: %d, Bloques: %d\n",
            meta.record_count, meta.block_count);
+    printf("Version activa: %s\n", version_dir);
+    if (timing) {
+        print_ingest_report(input, version_dir, meta.record_count,
+                            parse_time, write_time, index_time, now_seconds() - start_time);
+    }
     return 0;
 }
 
@@ -5,241 +5,883 @@
 #include <signal.h>
 #include <fcntl.h>
 #include <unistd.h>
-
-Metadata meta;
-BlockIndex *block_index = NULL;
-FILE *data_file = NULL;
-FILE *slot_file = NULL;
+#include <limits.h>
+#include <pthread.h>
+#include <math.h>
+
+// Versión del índice cargada en memoria. Las consultas en curso mantienen una
+// referencia, de modo que una recarga nunca libera los datos que están usando.
+typedef struct {
+    char dir[PATH_MAX];
+    Metadata meta;
+    BlockIndex *block_index;
+    const Record *records;              // data.bin mapeado
+    size_t data_size;
+    const FlatHashEntry *hash_entries;  // hashtable.bin mapeado
+    size_t hash_count;
+    size_t hash_size;
+    const char *wallet_names;                   // wallets.bin mapeado (opcional)
+    size_t wallet_count;
+    size_t wallet_names_size;
+    const WalletIndexEntry *wallet_entries;     // wallet_index.bin mapeado (opcional)
+    size_t wallet_entry_count;
+    size_t wallet_entries_size;
+    Statistics stats;
+    int refs;
+} Snapshot;
+
+// Caminos de acceso que puede elegir el planificador
+typedef enum {
+    PLAN_EMPTY,
+    PLAN_ROW_RANGE,
+    PLAN_KEY_INDEX,
+    PLAN_WALLET_INDEX,
+    PLAN_ZONE_MAP,
+    PLAN_FULL_SCAN
+} AccessPath;
+
+const char *access_path_names[] = { "empty", "row range", "key index", "wallet index", "zone map", "full scan" };
+
+// Plan de un grupo AND: camino elegido, su coste estimado y los rangos acotados
+typedef struct {
+    AccessPath path;
+    double cost;
+    unsigned long long row_min, row_max;
+    unsigned long long slot_min, slot_max;
+    unsigned long long tx_min, tx_max;
+    size_t index_first, index_last;  // Tramo del índice de wallets
+} QueryPlan;
+
+// Filas candidatas (índice en data.bin)
+typedef struct {
+    unsigned int *items;
+    size_t count;
+    size_t capacity;
+} RowList;
+
+// Fila candidata con el valor del campo de ORDER BY
+typedef struct {
+    unsigned long long value;
+    unsigned int row;
+} RankedRow;
+
+// Montículo acotado con las mejores filas; la raíz es la peor de ellas
+typedef struct {
+    RankedRow *items;
+    size_t count;
+    size_t capacity;
+    size_t limit;
+    int descending;
+} TopK;
+
+// Destino de las filas: lista completa o, con ORDER BY ... LIMIT, montículo de K filas.
+// Con LIMIT sin ORDER BY la lista deja de crecer tras limit filas del grupo en curso.
+typedef struct {
+    RowList rows;
+    TopK top;
+    int order_by;
+    size_t limit;
+    size_t group_start;
+} ResultSink;
+
+// Recorrido completo en paralelo: un montículo por hilo, fusionados al final
+typedef struct {
+    Snapshot *snap;
+    SearchRequest *req;
+    unsigned int first;
+    unsigned int last;
+    int order_by;
+    TopK top;
+    int ok;
+} ScanTask;
+
+#define RANDOM_READ_COST 4.0  // Coste de una lectura aleatoria frente a una secuencial
+#define MAX_SCAN_THREADS 8
+#define MIN_ROWS_PER_THREAD 65536
+
+Snapshot *current = NULL;
+pthread_mutex_t snapshot_lock = PTHREAD_MUTEX_INITIALIZER;
 
 void cleanup(int sig) {
     printf("\nSignal %d received. Cleaning up...\n", sig);
+    unlink(REQUEST_PIPE);
+    exit(0);
+}
+
+// Directorio de la versión activa; sin enlace se usa el directorio actual
+void resolve_segment_dir(char *dir, size_t size) {
+    ssize_t len = readlink(CURRENT_LINK, dir, size - 1);
+    if (len < 0) {
+        snprintf(dir, size, ".");
+        return;
+    }
+    dir[len] = '\0';
+}
+
+const void *map_file(const char *path, size_t *size) {
+    *size = 0;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) return NULL;
+
+    *size = st.st_size;
+    return addr;
+}
 
-    if (block_index) {
-        free(block_index);
-        block_index = NULL;
+// Trae a memoria todas las páginas antes de publicar la versión
+void warm_mapping(const void *addr, size_t size) {
+    if (!addr) return;
+    posix_madvise((void *)addr, size, POSIX_MADV_WILLNEED);
+
+    long page = sysconf(_SC_PAGESIZE);
+    volatile unsigned char sink = 0;
+    for (size_t i = 0; i < size; i += page) {
+        sink ^= ((const unsigned char *)addr)[i];
+    }
+    (void)sink;
+}
+
+void snapshot_destroy(Snapshot *snap) {
+    if (snap->records) munmap((void *)snap->records, snap->data_size);
+    if (snap->hash_entries) munmap((void *)snap->hash_entries, snap->hash_size);
+    if (snap->wallet_names) munmap((void *)snap->wallet_names, snap->wallet_names_size);
+    if (snap->wallet_entries) munmap((void *)snap->wallet_entries, snap->wallet_entries_size);
+    free(snap->block_index);
+    free(snap);
+}
+
+// Versiones sin stats.bin: estimación a partir de las zonas del índice de bloques
+void derive_statistics(Snapshot *snap) {
+    Statistics *st = &snap->stats;
+    st->min_slot = UINT_MAX;
+    st->max_slot = 0;
+    st->max_tx_idx = 0;  // Desconocido
+    for (unsigned int i = 0; i < snap->meta.block_count; i++) {
+        if (snap->block_index[i].min_slot < st->min_slot) st->min_slot = snap->block_index[i].min_slot;
+        if (snap->block_index[i].max_slot > st->max_slot) st->max_slot = snap->block_index[i].max_slot;
+    }
+    if (snap->meta.block_count == 0) st->min_slot = 0;
+    st->distinct_slots = st->max_slot - st->min_slot + 1;
+    if (st->distinct_slots > snap->meta.record_count) st->distinct_slots = snap->meta.record_count;
+}
+
+Snapshot *snapshot_load(const char *dir) {
+    char path[PATH_MAX + 32];
+    Snapshot *snap = calloc(1, sizeof(Snapshot));
+    if (!snap) {
+        perror("Error allocating snapshot");
+        return NULL;
     }
-    if (data_file) {
-        fclose(data_file);
-        data_file = NULL;
+    snprintf(snap->dir, sizeof(snap->dir), "%s", dir);
+
+    snprintf(path, sizeof(path), "%s/%s", dir, METADATA_FILE);
+    int meta_fd = open(path, O_RDONLY);
+    if (meta_fd < 0) {
+        perror("Error opening metadata");
+        free(snap);
+        return NULL;
     }
-    if (slot_file) {
+    if (read(meta_fd, &snap->meta, sizeof(Metadata)) != sizeof(Metadata)) {
+        perror("Error reading metadata");
+        close(meta_fd);
+        free(snap);
+        return NULL;
+    }
+    close(meta_fd);
+
+    if (snap->meta.record_size != sizeof(Record)) {
+        fprintf(stderr, "Incompatible record size in %s\n", dir);
+        free(snap);
+        return NULL;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", dir, DATA_FILE);
+    snap->records = map_file(path, &snap->data_size);
+    if (snap->data_size < (size_t)snap->meta.record_count * sizeof(Record)) {
+        fprintf(stderr, "Data file in %s is incomplete\n", dir);
+        snapshot_destroy(snap);
+        return NULL;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", dir, HASH_FILE);
+    snap->hash_entries = map_file(path, &snap->hash_size);
+    snap->hash_count = snap->hash_size / sizeof(FlatHashEntry);
+
+    // Índice compuesto (wallet, slot, tx_idx): solo si preprocess se ejecutó con -w
+    snprintf(path, sizeof(path), "%s/%s", dir, WALLET_DICT_FILE);
+    snap->wallet_names = map_file(path, &snap->wallet_names_size);
+    snap->wallet_count = snap->wallet_names_size / WALLET_SIZE;
+    snprintf(path, sizeof(path), "%s/%s", dir, WALLET_INDEX_FILE);
+    snap->wallet_entries = map_file(path, &snap->wallet_entries_size);
+    snap->wallet_entry_count = snap->wallet_entries_size / sizeof(WalletIndexEntry);
+
+    snprintf(path, sizeof(path), "%s/%s", dir, SLOT_INDEX_FILE);
+    FILE *slot_file = fopen(path, "rb");
+    if (!slot_file) {
+        perror("Error opening slot index file");
+        snapshot_destroy(snap);
+        return NULL;
+    }
+    snap->block_index = malloc(snap->meta.block_count * sizeof(BlockIndex));
+    if (!snap->block_index && snap->meta.block_count > 0) {
+        perror("Error allocating block index memory");
         fclose(slot_file);
-        slot_file = NULL;
+        snapshot_destroy(snap);
+        return NULL;
     }
+    if (fread(snap->block_index, sizeof(BlockIndex), snap->meta.block_count, slot_file) != snap->meta.block_count) {
+        perror("Error reading block index");
+        fclose(slot_file);
+        snapshot_destroy(snap);
+        return NULL;
+    }
+    fclose(slot_file);
 
-    unlink(REQUEST_PIPE);
-    exit(0);
+    snprintf(path, sizeof(path), "%s/%s", dir, STATS_FILE);
+    FILE *stats_file = fopen(path, "rb");
+    if (!stats_file || fread(&snap->stats, sizeof(Statistics), 1, stats_file) != 1) {
+        derive_statistics(snap);
+    }
+    if (stats_file) fclose(stats_file);
+
+    warm_mapping(snap->records, snap->data_size);
+    warm_mapping(snap->hash_entries, snap->hash_size);
+    warm_mapping(snap->wallet_names, snap->wallet_names_size);
+    warm_mapping(snap->wallet_entries, snap->wallet_entries_size);
+
+    snap->refs = 1;  // Referencia propia de "current"
+    return snap;
 }
 
-int matches_criteria(Record *record, SearchRequest *req) {
-    if (req->type1 != 0) {
-        switch (req->type1) {
-            case SEARCH_BY_SLOT:
-                if (record->slot != req->param1.slot) return 0;
-                break;
-            case SEARCH_BY_TX_IDX:
-                if (record->tx_idx != req->param1.tx_idx) return 0;
-                break;
-            case SEARCH_BY_DIRECTION:
-                if (strcmp(record->direction, req->param1.direction) != 0) return 0;
-                break;
-            case SEARCH_BY_WALLET:
-                if (strcmp(record->signing_wallet, req->param1.wallet) != 0) return 0;
-                break;
-            case SEARCH_BY_ROW:
-                break;
+Snapshot *snapshot_acquire(void) {
+    pthread_mutex_lock(&snapshot_lock);
+    Snapshot *snap = current;
+    snap->refs++;
+    pthread_mutex_unlock(&snapshot_lock);
+    return snap;
+}
+
+void snapshot_release(Snapshot *snap) {
+    pthread_mutex_lock(&snapshot_lock);
+    int last = --snap->refs == 0;
+    pthread_mutex_unlock(&snapshot_lock);
+    if (last) snapshot_destroy(snap);
+}
+
+// Sustituye la versión activa; la anterior se libera cuando termine su última consulta
+void snapshot_publish(Snapshot *snap) {
+    pthread_mutex_lock(&snapshot_lock);
+    Snapshot *old = current;
+    current = snap;
+    pthread_mutex_unlock(&snapshot_lock);
+    if (old) snapshot_release(old);
+}
+
+// Detecta nuevas versiones (SIGHUP o cambio de CURRENT_LINK) y las carga en segundo plano.
+// SIGHUP está bloqueada en todos los hilos: este la recoge con sigtimedwait y despierta al momento.
+void *reload_worker(void *arg) {
+    (void)arg;
+    char dir[PATH_MAX];
+    sigset_t hup;
+    sigemptyset(&hup);
+    sigaddset(&hup, SIGHUP);
+    struct timespec poll_interval = { RELOAD_POLL_SECONDS, 0 };
+
+    while (1) {
+        int forced = sigtimedwait(&hup, NULL, &poll_interval) == SIGHUP;
+
+        resolve_segment_dir(dir, sizeof(dir));
+
+        Snapshot *active = snapshot_acquire();
+        int changed = strcmp(active->dir, dir) != 0;
+        snapshot_release(active);
+        if (!forced && !changed) continue;
+
+        Snapshot *snap = snapshot_load(dir);
+        if (!snap) {
+            fprintf(stderr, "Reload of %s failed, keeping current version\n", dir);
+            continue;
         }
+        printf("Loaded version %s (Records: %u, Blocks: %u)\n",
+               dir, snap->meta.record_count, snap->meta.block_count);
+        snapshot_publish(snap);
     }
+    return NULL;
+}
 
-    if (req->type2 != 0) {
-        switch (req->type2) {
-            case SEARCH_BY_SLOT:
-                if (record->slot != req->param2.slot) return 0;
-                break;
-            case SEARCH_BY_TX_IDX:
-                if (record->tx_idx != req->param2.tx_idx) return 0;
-                break;
-            case SEARCH_BY_DIRECTION:
-                if (strcmp(record->direction, req->param2.direction) != 0) return 0;
-                break;
-            case SEARCH_BY_WALLET:
-                if (strcmp(record->signing_wallet, req->param2.wallet) != 0) return 0;
-                break;
-            case SEARCH_BY_ROW:
-                break;
+int matches_predicate(const Record *record, unsigned int row, Predicate *pred) {
+    switch (pred->type) {
+        case SEARCH_BY_SLOT:
+            return record->slot >= pred->min && record->slot <= pred->max;
+        case SEARCH_BY_TX_IDX:
+            return record->tx_idx >= pred->min && record->tx_idx <= pred->max;
+        case SEARCH_BY_DIRECTION:
+            return strcmp(record->direction, pred->text) == 0;
+        case SEARCH_BY_WALLET:
+            return strcmp(record->signing_wallet, pred->text) == 0;
+        case SEARCH_BY_ROW:
+            return row + 1 >= pred->min && row + 1 <= pred->max;
+    }
+    return 0;
+}
+
+int matches_group(const Record *record, unsigned int row, SearchRequest *req, int group) {
+    for (int i = 0; i < req->predicate_count; i++) {
+        if (req->predicates[i].group != group) continue;
+        if (!matches_predicate(record, row, &req->predicates[i])) return 0;
+    }
+    return 1;
+}
+
+int matches_request(const Record *record, unsigned int row, SearchRequest *req) {
+    if (req->predicate_count == 0) return 1;
+    for (int i = 0; i < req->predicate_count; i++) {
+        int group = req->predicates[i].group;
+        // Evaluar cada grupo una sola vez, en su primer predicado
+        int first = 1;
+        for (int k = 0; k < i; k++) {
+            if (req->predicates[k].group == group) first = 0;
         }
+        if (first && matches_group(record, row, req, group)) return 1;
     }
+    return 0;
+}
 
+// Fila del grupo groups[index] que ningún grupo anterior haya devuelto ya
+int accept_row(const Record *record, unsigned int row, SearchRequest *req, const int *groups, int index) {
+    if (!matches_group(record, row, req, groups[index])) return 0;
+    for (int i = 0; i < index; i++) {
+        if (matches_group(record, row, req, groups[i])) return 0;
+    }
     return 1;
 }
 
-long binary_search_offset(uint64_t target_key) {
-    FILE* f = fopen("hashtable.bin", "rb");
-    if (!f) {
-        perror("Error opening hashtable.bin for binary search");
-        return -1;
+int row_list_push(RowList *list, unsigned int row) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 256;
+        unsigned int *items = realloc(list->items, capacity * sizeof(unsigned int));
+        if (!items) {
+            perror("Memory realloc failed");
+            return 0;
+        }
+        list->items = items;
+        list->capacity = capacity;
     }
+    list->items[list->count++] = row;
+    return 1;
+}
 
-    fseek(f, 0, SEEK_END);
-    long file_size = ftell(f);
-    long num_entries = file_size / (sizeof(uint64_t) + sizeof(long));
-    rewind(f);
+// a va antes que b en el orden pedido (empates por posición en data.bin)
+int ranked_before(const RankedRow *a, const RankedRow *b, int descending) {
+    if (a->value != b->value) return descending ? a->value > b->value : a->value < b->value;
+    return a->row < b->row;
+}
 
-    long left = 0, right = num_entries - 1;
-    while (left <= right) {
-        long mid = (left + right) / 2;
-        fseek(f, mid * (sizeof(uint64_t) + sizeof(long)), SEEK_SET);
+void topk_swap(TopK *top, size_t i, size_t j) {
+    RankedRow tmp = top->items[i];
+    top->items[i] = top->items[j];
+    top->items[j] = tmp;
+}
 
-        uint64_t key;
-        long offset;
-        if (fread(&key, sizeof(uint64_t), 1, f) != 1 ||
-            fread(&offset, sizeof(long), 1, f) != 1) {
-            perror("Error reading hashtable.bin entry");
-            fclose(f);
-            return -1;
+int topk_offer(TopK *top, unsigned long long value, unsigned int row) {
+    RankedRow item = { value, row };
+
+    if (top->count == top->limit) {
+        if (!ranked_before(&item, &top->items[0], top->descending)) return 1;
+
+        // Sustituir la raíz y hundirla
+        top->items[0] = item;
+        size_t i = 0;
+        while (1) {
+            size_t worst = i, left = 2 * i + 1, right = 2 * i + 2;
+            if (left < top->count && ranked_before(&top->items[worst], &top->items[left], top->descending)) worst = left;
+            if (right < top->count && ranked_before(&top->items[worst], &top->items[right], top->descending)) worst = right;
+            if (worst == i) break;
+            topk_swap(top, i, worst);
+            i = worst;
         }
+        return 1;
+    }
+
+    if (top->count == top->capacity) {
+        size_t capacity = top->capacity ? top->capacity * 2 : 64;
+        if (capacity > top->limit) capacity = top->limit;
+        RankedRow *items = realloc(top->items, capacity * sizeof(RankedRow));
+        if (!items) {
+            perror("Memory realloc failed");
+            return 0;
+        }
+        top->items = items;
+        top->capacity = capacity;
+    }
+
+    // Insertar al final y subir mientras sea peor que su padre
+    size_t i = top->count++;
+    top->items[i] = item;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!ranked_before(&top->items[parent], &top->items[i], top->descending)) break;
+        topk_swap(top, i, parent);
+        i = parent;
+    }
+    return 1;
+}
+
+// Devuelve 0 cuando hay que detener el recorrido (error o LIMIT alcanzado)
+int sink_push(ResultSink *sink, const Record *record, unsigned int row) {
+    if (sink->top.limit > 0) {
+        return topk_offer(&sink->top, record_field_value(record, sink->order_by), row);
+    }
+    if (!row_list_push(&sink->rows, row)) return 0;
+    return sink->limit == 0 || sink->rows.count - sink->group_start < sink->limit;
+}
+
+int compare_ranked_asc(const void *a, const void *b) {
+    return ranked_before(b, a, 0) - ranked_before(a, b, 0);
+}
 
-        if (key == target_key) {
-            fclose(f);
-            return offset;
-        } else if (key < target_key) {
+int compare_ranked_desc(const void *a, const void *b) {
+    return ranked_before(b, a, 1) - ranked_before(a, b, 1);
+}
+
+void *scan_worker(void *arg) {
+    ScanTask *task = arg;
+    task->ok = 1;
+    for (unsigned int row = task->first; row < task->last; row++) {
+        const Record *record = &task->snap->records[row];
+        if (!matches_request(record, row, task->req)) continue;
+        if (!topk_offer(&task->top, record_field_value(record, task->order_by), row)) {
+            task->ok = 0;
+            break;
+        }
+    }
+    return NULL;
+}
+
+// Recorrido completo para ORDER BY ... LIMIT: memoria O(hilos * K)
+void parallel_topk_scan(Snapshot *snap, SearchRequest *req, ResultSink *sink) {
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    long max_threads = snap->meta.record_count / MIN_ROWS_PER_THREAD;
+    if (threads > max_threads) threads = max_threads;
+    if (threads > MAX_SCAN_THREADS) threads = MAX_SCAN_THREADS;
+    if (threads < 1) threads = 1;
+
+    ScanTask tasks[MAX_SCAN_THREADS];
+    pthread_t ids[MAX_SCAN_THREADS];
+    int started[MAX_SCAN_THREADS];
+    unsigned int chunk = snap->meta.record_count / threads;
+    for (long t = 0; t < threads; t++) {
+        tasks[t] = (ScanTask){
+            .snap = snap,
+            .req = req,
+            .first = t * chunk,
+            .last = t == threads - 1 ? snap->meta.record_count : (t + 1) * chunk,
+            .order_by = sink->order_by,
+            .top = { NULL, 0, 0, sink->top.limit, sink->top.descending },
+            .ok = 0
+        };
+        started[t] = threads > 1 && pthread_create(&ids[t], NULL, scan_worker, &tasks[t]) == 0;
+        if (!started[t]) scan_worker(&tasks[t]);
+    }
+
+    for (long t = 0; t < threads; t++) {
+        if (started[t]) pthread_join(ids[t], NULL);
+        if (!tasks[t].ok) fprintf(stderr, "Scan thread %ld failed\n", t);
+        for (size_t i = 0; i < tasks[t].top.count; i++) {
+            topk_offer(&sink->top, tasks[t].top.items[i].value, tasks[t].top.items[i].row);
+        }
+        free(tasks[t].top.items);
+    }
+    printf("Plan: top-%u scan with %ld thread(s)\n", req->limit, threads);
+}
+
+int compare_rows(const void *a, const void *b) {
+    unsigned int ra = *(const unsigned int *)a;
+    unsigned int rb = *(const unsigned int *)b;
+    return (ra > rb) - (ra < rb);
+}
+
+// Primera entrada de hashtable.bin con clave >= target_key
+size_t key_lower_bound(Snapshot *snap, uint64_t target_key) {
+    size_t left = 0, right = snap->hash_count;
+    while (left < right) {
+        size_t mid = left + (right - left) / 2;
+        if (snap->hash_entries[mid].key < target_key) {
             left = mid + 1;
         } else {
-            right = mid - 1;
+            right = mid;
         }
     }
+    return left;
+}
 
-    fclose(f);
+// Id de la wallet en wallets.bin, o -1 si no existe
+long wallet_lookup(Snapshot *snap, const char *wallet) {
+    size_t left = 0, right = snap->wallet_count;
+    while (left < right) {
+        size_t mid = left + (right - left) / 2;
+        int cmp = strncmp(snap->wallet_names + mid * WALLET_SIZE, wallet, WALLET_SIZE);
+        if (cmp == 0) return mid;
+        if (cmp < 0) left = mid + 1;
+        else right = mid;
+    }
     return -1;
 }
 
-void combined_search(SearchRequest *req, Record **results, int *count) {
-    *count = 0;
-    *results = NULL;
+// Primera entrada del índice de wallets mayor (strict) o no menor que (wallet_id, key)
+size_t wallet_bound(Snapshot *snap, uint32_t wallet_id, uint64_t key, int strict) {
+    size_t left = 0, right = snap->wallet_entry_count;
+    while (left < right) {
+        size_t mid = left + (right - left) / 2;
+        const WalletIndexEntry *entry = &snap->wallet_entries[mid];
+        uint64_t entry_key = ((uint64_t)entry->slot << 32) | entry->tx_idx;
+        int before = entry->wallet_id < wallet_id ||
+                     (entry->wallet_id == wallet_id && (strict ? entry_key <= key : entry_key < key));
+        if (before) {
+            left = mid + 1;
+        } else {
+            right = mid;
+        }
+    }
+    return left;
+}
 
-    Record record;
+unsigned int block_first_row(Snapshot *snap, unsigned int block) {
+    if (block >= snap->meta.block_count) return snap->meta.record_count;
+    return snap->block_index[block].offset / sizeof(Record);
+}
 
-    if (req->type1 == SEARCH_BY_ROW) {
-        if (req->param1.row < 1 || req->param1.row > meta.record_count) return;
-        long offset = (req->param1.row - 1) * sizeof(Record);
-        fseek(data_file, offset, SEEK_SET);
-        fread(&record, sizeof(Record), 1, data_file);
-        *results = malloc(sizeof(Record));
-        if (*results) {
-            (*results)[0] = record;
-            *count = 1;
+// Filas [first, end) del bloque dentro del rango de filas del plan; 0 si no hay ninguna
+int block_row_span(Snapshot *snap, QueryPlan *plan, unsigned int block, unsigned int *first, unsigned int *end) {
+    *first = block_first_row(snap, block);
+    *end = block_first_row(snap, block + 1);
+    if (*first < plan->row_min - 1) *first = plan->row_min - 1;
+    if (*end > plan->row_max) *end = plan->row_max;
+    return *first < *end;
+}
+
+// Posición en data.bin (desde 0) dentro del rango de filas del plan (desde 1)
+int row_in_plan(QueryPlan *plan, unsigned int row) {
+    return row + 1ULL >= plan->row_min && row + 1ULL <= plan->row_max;
+}
+
+// Filas estimadas con slot en [slot_min, slot_max]
+double estimate_slot_rows(Snapshot *snap, unsigned long long slot_min, unsigned long long slot_max) {
+    Statistics *st = &snap->stats;
+    if (st->distinct_slots == 0) return 0;
+    unsigned long long lo = slot_min > st->min_slot ? slot_min : st->min_slot;
+    unsigned long long hi = slot_max < st->max_slot ? slot_max : st->max_slot;
+    if (lo > hi) return 0;
+
+    double span = (double)st->max_slot - st->min_slot + 1;
+    double slots = st->distinct_slots * ((hi - lo + 1) / span);
+    if (slots < 1) slots = 1;
+    return (double)snap->meta.record_count / st->distinct_slots * slots;
+}
+
+// Fracción de filas con tx_idx en [tx_min, tx_max]
+double estimate_tx_fraction(Snapshot *snap, unsigned long long tx_min, unsigned long long tx_max) {
+    Statistics *st = &snap->stats;
+    if (st->max_tx_idx == 0) return 1.0;
+    if (tx_min > st->max_tx_idx) return 0.0;
+    unsigned long long hi = tx_max < st->max_tx_idx ? tx_max : st->max_tx_idx;
+    return (double)(hi - tx_min + 1) / ((double)st->max_tx_idx + 1);
+}
+
+QueryPlan plan_group(Snapshot *snap, SearchRequest *req, int group) {
+    QueryPlan plan = {
+        .path = PLAN_FULL_SCAN,
+        .cost = snap->meta.record_count,
+        .row_min = 1, .row_max = snap->meta.record_count,
+        .slot_min = 0, .slot_max = UINT_MAX,
+        .tx_min = 0, .tx_max = UINT_MAX
+    };
+    int has_slot = 0;
+    const char *wallet = NULL;
+
+    for (int i = 0; i < req->predicate_count; i++) {
+        Predicate *pred = &req->predicates[i];
+        if (pred->group != group) continue;
+        switch (pred->type) {
+            case SEARCH_BY_ROW:
+                if (pred->min > plan.row_min) plan.row_min = pred->min;
+                if (pred->max < plan.row_max) plan.row_max = pred->max;
+                break;
+            case SEARCH_BY_SLOT:
+                if (pred->min > plan.slot_min) plan.slot_min = pred->min;
+                if (pred->max < plan.slot_max) plan.slot_max = pred->max;
+                has_slot = 1;
+                break;
+            case SEARCH_BY_TX_IDX:
+                if (pred->min > plan.tx_min) plan.tx_min = pred->min;
+                if (pred->max < plan.tx_max) plan.tx_max = pred->max;
+                break;
+            case SEARCH_BY_WALLET:
+                wallet = pred->text;
+                break;
+            default:
+                break;
         }
-        return;
     }
 
-    if (req->type2 == SEARCH_BY_ROW) {
-        if (req->param2.row < 1 || req->param2.row > meta.record_count) return;
-        long offset = (req->param2.row - 1) * sizeof(Record);
-        fseek(data_file, offset, SEEK_SET);
-        fread(&record, sizeof(Record), 1, data_file);
-        *results = malloc(sizeof(Record));
-        if (*results) {
-            (*results)[0] = record;
-            *count = 1;
+    if (plan.row_min > plan.row_max || plan.slot_min > plan.slot_max || plan.tx_min > plan.tx_max) {
+        plan.path = PLAN_EMPTY;
+        plan.cost = 0;
+        return plan;
+    }
+
+    // Un rango de filas es un candidato más; los demás caminos también lo respetan
+    if (plan.row_max - plan.row_min + 1 < snap->meta.record_count) {
+        plan.path = PLAN_ROW_RANGE;
+        plan.cost = plan.row_max - plan.row_min + 1;
+    }
+
+    // Con el índice compuesto el número de entradas se conoce exactamente
+    if (wallet && snap->wallet_entries) {
+        long wallet_id = wallet_lookup(snap, wallet);
+        if (wallet_id < 0) {
+            plan.path = PLAN_EMPTY;
+            plan.cost = 0;
+            return plan;
         }
-        return;
+        plan.index_first = wallet_bound(snap, wallet_id, (plan.slot_min << 32) | plan.tx_min, 0);
+        plan.index_last = wallet_bound(snap, wallet_id, (plan.slot_max << 32) | plan.tx_max, 1);
+        double wallet_cost = 2 * log2((double)snap->wallet_entry_count + 1)
+                           + (plan.index_last - plan.index_first) * RANDOM_READ_COST;
+        if (wallet_cost < plan.cost) {
+            plan.path = PLAN_WALLET_INDEX;
+            plan.cost = wallet_cost;
+        }
+    }
+
+    // El slot es la columna principal de la clave del índice y de las zonas
+    if (!has_slot) return plan;
+
+    double estimated = estimate_slot_rows(snap, plan.slot_min, plan.slot_max)
+                     * estimate_tx_fraction(snap, plan.tx_min, plan.tx_max);
+    double key_cost = log2((double)snap->hash_count + 1) + estimated * RANDOM_READ_COST;
+    if (snap->hash_count > 0 && key_cost < plan.cost) {
+        plan.path = PLAN_KEY_INDEX;
+        plan.cost = key_cost;
     }
 
-    // Binary search lookup for (slot + tx_idx)
-    if (req->type1 == SEARCH_BY_SLOT && req->type2 == SEARCH_BY_TX_IDX) {
-        uint64_t key = ((uint64_t)req->param1.slot << 32) | req->param2.tx_idx;
-        long offset = binary_search_offset(key);
-        if (offset >= 0) {
-            fseek(data_file, offset, SEEK_SET);
-            fread(&record, sizeof(Record), 1, data_file);
-            *results = malloc(sizeof(Record));
-            if (*results) {
-                (*results)[0] = record;
-                *count = 1;
+    double zone_cost = 0;
+    for (unsigned int i = 0; i < snap->meta.block_count; i++) {
+        if (snap->block_index[i].max_slot < plan.slot_min || snap->block_index[i].min_slot > plan.slot_max) continue;
+        unsigned int first, end;
+        if (block_row_span(snap, &plan, i, &first, &end)) zone_cost += end - first;
+    }
+    if (zone_cost < plan.cost) {
+        plan.path = PLAN_ZONE_MAP;
+        plan.cost = zone_cost;
+    }
+
+    return plan;
+}
+
+void execute_plan(Snapshot *snap, SearchRequest *req, const int *groups, int index, QueryPlan *plan, ResultSink *sink) {
+    switch (plan->path) {
+        case PLAN_EMPTY:
+        case PLAN_FULL_SCAN:
+            break;
+
+        case PLAN_ROW_RANGE: {
+            for (unsigned long long row = plan->row_min; row <= plan->row_max; row++) {
+                const Record *record = &snap->records[row - 1];
+                if (accept_row(record, row - 1, req, groups, index) && !sink_push(sink, record, row - 1)) return;
             }
+            break;
         }
-        return;
-    }
 
-    // Otherwise, scan blocks with criteria filtering
-    const size_t block_size = 1000;
-    for (unsigned int i = 0; i < meta.block_count; i++) {
-        long block_offset = block_index[i].offset;
-
-        size_t records_in_block = (i == meta.block_count - 1)
-            ? (meta.record_count % block_size) : block_size;
-        if (records_in_block == 0) records_in_block = block_size;
-
-        for (size_t j = 0; j < records_in_block; j++) {
-            long offset = block_offset + j * sizeof(Record);
-            fseek(data_file, offset, SEEK_SET);
-            fread(&record, sizeof(Record), 1, data_file);
-            if (matches_criteria(&record, req)) {
-                if (*count % 100 == 0) {
-                    *results = realloc(*results, (*count + 100) * sizeof(Record));
-                    if (!*results) {
-                        perror("Memory realloc failed");
-                        return;
-                    }
-                }
-                (*results)[*count] = record;
-                (*count)++;
+        case PLAN_KEY_INDEX: {
+            uint64_t first = (plan->slot_min << 32) | plan->tx_min;
+            uint64_t last = (plan->slot_max << 32) | plan->tx_max;
+            for (size_t i = key_lower_bound(snap, first); i < snap->hash_count; i++) {
+                uint64_t key = snap->hash_entries[i].key;
+                if (key > last) break;
+                unsigned int tx_idx = key & 0xFFFFFFFFu;
+                if (tx_idx < plan->tx_min || tx_idx > plan->tx_max) continue;
+
+                unsigned int row = snap->hash_entries[i].offset / sizeof(Record);
+                if (!row_in_plan(plan, row)) continue;
+                const Record *record = &snap->records[row];
+                if (accept_row(record, row, req, groups, index) && !sink_push(sink, record, row)) return;
             }
+            break;
         }
-    }
 
-    if (*count > 0) {
-        *results = realloc(*results, *count * sizeof(Record));
+        case PLAN_WALLET_INDEX:
+            for (size_t i = plan->index_first; i < plan->index_last; i++) {
+                const WalletIndexEntry *entry = &snap->wallet_entries[i];
+                if (entry->tx_idx < plan->tx_min || entry->tx_idx > plan->tx_max) continue;
+
+                unsigned int row = entry->offset / sizeof(Record);
+                if (!row_in_plan(plan, row)) continue;
+                const Record *record = &snap->records[row];
+                if (accept_row(record, row, req, groups, index) && !sink_push(sink, record, row)) return;
+            }
+            break;
+
+        case PLAN_ZONE_MAP:
+            for (unsigned int i = 0; i < snap->meta.block_count; i++) {
+                if (snap->block_index[i].max_slot < plan->slot_min || snap->block_index[i].min_slot > plan->slot_max) continue;
+                unsigned int first, end;
+                if (!block_row_span(snap, plan, i, &first, &end)) continue;
+                for (unsigned int row = first; row < end; row++) {
+                    const Record *record = &snap->records[row];
+                    if (accept_row(record, row, req, groups, index) && !sink_push(sink, record, row)) return;
+                }
+            }
+            break;
     }
 }
 
-int main() {
-    signal(SIGINT, cleanup);
-    signal(SIGTERM, cleanup);
-    signal(SIGSEGV, cleanup);
+// Filas compactas con los campos de req->field_mask (ver pack_record)
+void combined_search(Snapshot *snap, SearchRequest *req, unsigned char **results, size_t *size, int *count) {
+    *count = 0;
+    *size = 0;
+    *results = NULL;
 
-    int meta_fd = open(METADATA_FILE, O_RDONLY);
-    if (meta_fd < 0) {
-        perror("Error opening metadata");
-        return 1;
+    if (req->predicate_count < 0 || req->predicate_count > MAX_PREDICATES) return;
+    if (req->order_by != ORDER_NONE &&
+        (req->order_by < 0 || req->order_by >= FIELD_COUNT || record_field(req->order_by)->is_text)) return;
+    int ordered = req->order_by != ORDER_NONE;
+    for (int i = 0; i < req->predicate_count; i++) {
+        if (req->predicates[i].group >= MAX_PREDICATES) return;
+        req->predicates[i].text[sizeof(req->predicates[i].text) - 1] = '\0';
     }
-    if (read(meta_fd, &meta, sizeof(Metadata)) != sizeof(Metadata)) {
-        perror("Error reading metadata");
-        close(meta_fd);
-        return 1;
+
+    // Un plan por grupo AND
+    QueryPlan plans[MAX_PREDICATES];
+    int groups[MAX_PREDICATES];
+    int group_count = 0;
+    double total_cost = 0;
+    for (int g = 0; g < MAX_PREDICATES; g++) {
+        int used = 0;
+        for (int i = 0; i < req->predicate_count; i++) {
+            if (req->predicates[i].group == g) used = 1;
+        }
+        if (!used) continue;
+        plans[group_count] = plan_group(snap, req, g);
+        groups[group_count] = g;
+        total_cost += plans[group_count].cost;
+        printf("Plan: group %d -> %s (cost %.0f)\n",
+               g, access_path_names[plans[group_count].path], plans[group_count].cost);
+        group_count++;
     }
-    close(meta_fd);
 
-    data_file = fopen(DATA_FILE, "rb");
-    if (!data_file) {
-        perror("Error opening data file");
-        cleanup(0);
-        return 1;
+    ResultSink sink = {
+        .rows = { NULL, 0, 0 },
+        .top = { NULL, 0, 0, ordered ? req->limit : 0, req->descending },
+        .order_by = req->order_by,
+        .limit = ordered ? 0 : req->limit,
+        .group_start = 0
+    };
+    int full_scan = group_count == 0 || total_cost >= snap->meta.record_count;
+    if (full_scan && sink.top.limit > 0) {
+        parallel_topk_scan(snap, req, &sink);
+    } else if (full_scan) {
+        // Un único recorrido evalúa todos los grupos a la vez
+        printf("Plan: filtered scan of %u records\n", snap->meta.record_count);
+        for (unsigned int row = 0; row < snap->meta.record_count; row++) {
+            const Record *record = &snap->records[row];
+            if (matches_request(record, row, req) && !sink_push(&sink, record, row)) break;
+        }
+    } else {
+        for (int i = 0; i < group_count; i++) {
+            sink.group_start = sink.rows.count;
+            execute_plan(snap, req, groups, i, &plans[i], &sink);
+        }
     }
 
-    slot_file = fopen(SLOT_INDEX_FILE, "rb");
-    if (!slot_file) {
-        perror("Error opening slot index file");
-        cleanup(0);
-        return 1;
+    RowList rows = sink.rows;
+    if (ordered) {
+        // Con LIMIT ya están solo las K mejores; sin él se ordenan todas
+        RankedRow *ranked = sink.top.items;
+        size_t ranked_count = sink.top.count;
+        if (sink.top.limit == 0) {
+            ranked = malloc(rows.count * sizeof(RankedRow));
+            ranked_count = ranked ? rows.count : 0;
+            if (!ranked && rows.count > 0) perror("Memory allocation failed");
+            for (size_t i = 0; i < ranked_count; i++) {
+                ranked[i].value = record_field_value(&snap->records[rows.items[i]], req->order_by);
+                ranked[i].row = rows.items[i];
+            }
+            free(rows.items);
+        }
+        qsort(ranked, ranked_count, sizeof(RankedRow), req->descending ? compare_ranked_desc : compare_ranked_asc);
+
+        rows.items = malloc(ranked_count * sizeof(unsigned int));
+        rows.count = rows.items ? ranked_count : 0;
+        if (!rows.items && ranked_count > 0) perror("Memory allocation failed");
+        for (size_t i = 0; i < rows.count; i++) {
+            rows.items[i] = ranked[i].row;
+        }
+        free(ranked);
+    } else if (group_count > 1 && !full_scan && rows.count > 1) {
+        // Un solo grupo conserva el orden de su camino de acceso (los índices dan
+        // orden por slot y tx_idx). Varios grupos se devuelven en orden de data.bin.
+        qsort(rows.items, rows.count, sizeof(unsigned int), compare_rows);
     }
+    if (req->limit > 0 && rows.count > req->limit) rows.count = req->limit;
 
-    block_index = malloc(meta.block_count * sizeof(BlockIndex));
-    if (!block_index) {
-        perror("Error allocating block index memory");
+    unsigned int mask = effective_field_mask(req->field_mask);
+    if (rows.count > 0) {
+        *results = malloc(rows.count * packed_row_limit(mask));
+        if (*results) {
+            for (size_t i = 0; i < rows.count; i++) {
+                *size += pack_record(&snap->records[rows.items[i]], mask, *results + *size);
+            }
+            *count = rows.count;
+        } else {
+            perror("Memory allocation failed");
+        }
+    }
+    free(rows.items);
+}
+
+int main() {
+    signal(SIGINT, cleanup);
+    signal(SIGTERM, cleanup);
+    signal(SIGSEGV, cleanup);
+    signal(SIGPIPE, SIG_IGN);  // Un cliente que se va no debe detener el servidor
+
+    // Bloquear SIGHUP antes de crear hilos; solo reload_worker la espera
+    sigset_t hup;
+    sigemptyset(&hup);
+    sigaddset(&hup, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &hup, NULL);
+
+    char dir[PATH_MAX];
+    resolve_segment_dir(dir, sizeof(dir));
+    current = snapshot_load(dir);
+    if (!current) {
         cleanup(0);
         return 1;
     }
-    if (fread(block_index, sizeof(BlockIndex), meta.block_count, slot_file) != meta.block_count) {
-        perror("Error reading block index");
+
+    pthread_t reload_thread;
+    if (pthread_create(&reload_thread, NULL, reload_worker, NULL) != 0) {
+        perror("Error starting reload thread");
         cleanup(0);
         return 1;
     }
+    pthread_detach(reload_thread);
 
     mkfifo(REQUEST_PIPE, 0666);
 
     printf("Server running (PID: %d)\n", getpid());
-    printf("Records: %u, Blocks: %u\n", meta.record_count, meta.block_count);
+    printf("Version: %s\n", current->dir);
+    printf("Records: %u, Blocks: %u\n", current->meta.record_count, current->meta.block_count);
 
     while (1) {
         printf("Waiting for client requests...\n");
@@ -257,10 +899,13 @@ int main() {
         }
         close(request_fd);
 
-        Record *results = NULL;
+        unsigned char *results = NULL;
+        size_t size = 0;
         int count = 0;
 
-        combined_search(&req, &results, &count);
+        Snapshot *snap = snapshot_acquire();
+        combined_search(snap, &req, &results, &size, &count);
+        snapshot_release(snap);
 
         char response_pipe[256];
         snprintf(response_pipe, sizeof(response_pipe), RESPONSE_PIPE_TEMPLATE, req.client_pid);
@@ -271,19 +916,20 @@ int main() {
             continue;
         }
 
+        uint64_t payload = size;
         if (write(response_fd, &count, sizeof(int)) != sizeof(int)) {
             perror("Error writing result count");
         } else if (count > 0) {
-            if (write(response_fd, results, count * sizeof(Record)) != (ssize_t)(count * sizeof(Record))) {
+            if (write(response_fd, &payload, sizeof(uint64_t)) != sizeof(uint64_t) ||
+                write(response_fd, results, size) != (ssize_t)size) {
                 perror("Error writing records");
             }
-            free(results);
         }
+        free(results);
 
         close(response_fd);
-        printf("Search complete. Results: %d\n", count);
+        printf("Search complete. Results: %d (%zu bytes)\n", count, size);
     }
 
     return 0;
 }
-